@@ -5,53 +5,270 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include "memory.h"
 #include "byutr.h"
 
+/* Set by SIGINT/SIGTERM so a live session can be stopped with statistics */
+static volatile sig_atomic_t stop;
+
+/* Accesses simulated so far, and how often to report rolling hit rates */
+static unsigned long long accesses;
+static unsigned long interval;
+
+/* The time field of a record is an unsigned long, which is 32 bits with
+ * -m32 and wraps on long traces. Each wrap adds ULONG_MAX + 1 to time_base.
+ */
+static unsigned long long time_base;
+static unsigned long last_time;
+
+/* Report interval used for a time series when -i is not given */
+#define SERIES_INTERVAL 100000
+
+static void handle_stop(int sig)
+{
+  stop = 1;
+}
+
+/*
+ * Open the trace source: "-" is stdin, "unix:<path>" listens on a local
+ * Unix socket and accepts one connection, anything else (file or FIFO) is
+ * opened by name. A stale socket left at the path is replaced, but any
+ * other existing file is left alone and the open fails.
+ */
+static FILE *trace_open(const char *name)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int listener, conn;
+
+  if (strcmp(name, "-") == 0)
+  {
+    return stdin;
+  }
+  if (strncmp(name, "unix:", 5) != 0)
+  {
+    /* fopen(argv[1], "r") -> fopen(argv[1], "rb")
+     * Windows doesn't follow POSIX here and fopen needs the 'b' to function
+     * properly.
+     */
+    return fopen(name, "rb");
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(name + 5) >= sizeof(addr.sun_path))
+  {
+    return NULL;
+  }
+  strcpy(addr.sun_path, name + 5);
+  if (stat(addr.sun_path, &st) == 0)
+  {
+    if (!S_ISSOCK(st.st_mode))
+    {
+      fprintf(stderr, "Not a socket: %s\n", addr.sun_path);
+      return NULL;
+    }
+    unlink(addr.sun_path);
+  }
+
+  if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+  {
+    return NULL;
+  }
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0)
+  {
+    close(listener);
+    return NULL;
+  }
+  fprintf(stderr, "Waiting for trace on %s\n", addr.sun_path);
+  conn = accept(listener, NULL, NULL);
+  close(listener);
+  unlink(addr.sun_path);
+  if (conn < 0)
+  {
+    return NULL;
+  }
+  return fdopen(conn, "rb");
+}
+
+/*
+ * Simulate one access and report rolling hit rates every interval accesses
+ */
+static void simulate(unsigned char reqtype, unsigned int addr)
+{
+  switch(reqtype)
+  {
+  case FETCH:    memory_fetch(addr, NULL); break;
+  case MEMREAD:  memory_read(addr, NULL); break;
+  case MEMWRITE: memory_write(addr, NULL); break;
+  default: printf("Ignoring trace record with type %d\n", reqtype); return;
+  }
+  if (interval && ++accesses % interval == 0)
+  {
+    memory_report(0);
+  }
+}
+
 /*
- * Command line argument: Trace file.
+ * Parse one line of valgrind lackey output (--trace-mem=yes):
+ * "I  04000c70,2", " L fe977a88,4", " S ...", " M ..."
+ * A modify is simulated as a read followed by a write.
+ * Lackey on 64-bit hosts prints addresses wider than 32 bits (such as the
+ * stack at 1ffefffd48). The simulator has a 32-bit address space, so only
+ * the low 32 bits are kept, like the cache index and tag of a real address.
+ */
+static void lackey_line(const char *line)
+{
+  char type;
+  char *end;
+  unsigned long long addr;
+
+  while (*line == ' ')
+  {
+    line++;
+  }
+  /* Anything else, such as "==pid==" comment lines, is skipped */
+  type = *line++;
+  if (type != 'I' && type != 'L' && type != 'S' && type != 'M')
+  {
+    return;
+  }
+  addr = strtoull(line, &end, 16);
+  if (end == line || *end != ',')
+  {
+    return;
+  }
+
+  switch(type)
+  {
+  case 'I': simulate(FETCH, (unsigned int)addr); break;
+  case 'L': simulate(MEMREAD, (unsigned int)addr); break;
+  case 'S': simulate(MEMWRITE, (unsigned int)addr); break;
+  case 'M': simulate(MEMREAD, (unsigned int)addr);
+            simulate(MEMWRITE, (unsigned int)addr); break;
+  }
+}
+
+/*
+ * Command line arguments: Options and trace source.
  */
 int main(int argc, char *argv[])
 {
-  FILE *tracef;
+  FILE *tracef, *seriesf = NULL;
   p2AddrTr tr;
+  char line[1024];
+  struct sigaction sa;
+  char *end;
+  int opt, lackey = 0, usage = 0;
+
+  while ((opt = getopt(argc, argv, "lqi:s:")) != -1)
+  {
+    switch(opt)
+    {
+    case 'l': lackey = 1; break;
+    case 'q': memory_verbose(0); break;
+    case 'i':
+      interval = strtoul(optarg, &end, 10);
+      /* Reject anything that is not a positive number */
+      if (*optarg < '0' || *optarg > '9' || *end != '\0' || interval == 0)
+      {
+        usage = 1;
+      }
+      break;
+    case 's':
+      if ((seriesf = fopen(optarg, "w")) == NULL)
+      {
+        printf("Could not open file: %s\n", optarg);
+        exit(1);
+      }
+      break;
+    default: usage = 1; break;
+    }
+  }
 
-  if (argc < 2)
+  if (usage || optind != argc - 1)
   {
-    printf("Usage: %s filename\n", argv[0]);
+    printf("Usage: %s [-l] [-q] [-i interval] [-s series.csv] filename | - | unix:path\n", argv[0]);
+    printf("  -l           trace is valgrind lackey text instead of binary records\n");
+    printf("  -q           do not print every access\n");
+    printf("  -i interval  report rolling hit rates every interval accesses\n");
+    printf("  -s file      write per-interval counters and phases to a CSV file\n");
     exit(1);
   }
 
-  /* fopen(argv[1], "r") -> fopen(argv[1], "rb")
-   * Windows doesn't follow POSIX here and fopen needs the 'b' to function
-   * properly.
-   */
-  if ((tracef = fopen(argv[1], "rb")) == NULL)
+  if ((tracef = trace_open(argv[optind])) == NULL)
   {
-    printf("Could not open file: %s\n", argv[1]);
+    printf("Could not open file: %s\n", argv[optind]);
     exit(1);
   }
 
+  /* No SA_RESTART, so a blocking read on a pipe or socket is interrupted */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
   memory_init(); /* Initialize the memory subsystem */
 
-  /* Loop through the trace file and simulate memory accesses */
-  while (!feof(tracef))
+  if (seriesf != NULL)
+  {
+    memory_series(seriesf);
+    if (interval == 0)
+    {
+      interval = SERIES_INTERVAL;
+    }
+  }
+
+  /* Loop through the trace and simulate memory accesses */
+  if (lackey)
   {
-    if (fread(&tr, sizeof(p2AddrTr), 1, tracef) == 1)
+    while (!stop && fgets(line, sizeof(line), tracef) != NULL)
     {
-      switch(tr.reqtype)
+      lackey_line(line);
+    }
+  }
+  else
+  {
+    while (!stop && fread(&tr, sizeof(p2AddrTr), 1, tracef) == 1)
+    {
+      /* Records without a time (0) are skipped, and only a jump back by
+       * more than half the range is a wrap rather than a record that is
+       * slightly out of order
+       */
+      if (tr.time != 0)
       {
-      case FETCH:    memory_fetch(tr.addr, NULL); break;
-      case MEMREAD:  memory_read(tr.addr, NULL); break;
-      case MEMWRITE: memory_write(tr.addr, NULL); break;
-      default: printf("Ignoring trace record with type %d\n", tr.reqtype);
+        if (last_time != 0 && tr.time < last_time && last_time - tr.time > ULONG_MAX / 2)
+        {
+          time_base += (unsigned long long)ULONG_MAX + 1;
+        }
+        last_time = tr.time;
       }
+      memory_time(tr.time ? time_base + tr.time : 0);
+      simulate(tr.reqtype, tr.addr);
     }
   }
 
   fclose(tracef);
 
+  /* Report the last, partial interval */
+  if (interval && accesses % interval != 0)
+  {
+    memory_report(1);
+  }
+
   memory_finish(); /* Deinitialize the memory subsystem */
 
+  if (seriesf != NULL)
+  {
+    fclose(seriesf);
+  }
+
   return 0;
 }
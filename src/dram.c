@@ -0,0 +1,227 @@
+
+#include "dram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Flat memory parameters
+#define flat_latency 200
+
+// DRAM organization
+#define dram_channels 2
+#define dram_ranks 2
+#define dram_banks 8
+#define dram_row_size 8192
+// Bytes moved by one burst; a block takes one burst per 64 bytes
+#define dram_burst_size 64
+// Row buffer policy; 1 = open-page, 0 = closed-page
+#define dram_page_policy 1
+// Address mapping, most to least significant;
+// 0 = row:rank:bank:channel:column, 1 = row:column:rank:bank:channel,
+// 2 = as 0 but with the bank XOR-ed with the low row bits
+#define dram_mapping 0
+
+// DRAM timing in CPU cycles
+#define dram_tCAS 42
+#define dram_tRCD 42
+#define dram_tRP 42
+#define dram_tBURST 12
+// CPU clock in MHz, used to turn cycles into bandwidth
+#define dram_cpu_mhz 3000
+
+// Flat memory statistics
+static unsigned long long flat_reads, flat_writes;
+
+// Typedef-ing structures
+typedef struct bank bank_t;
+
+// Structure for each bank
+struct bank {
+  int open;
+  unsigned int row;
+  unsigned long long ready;
+};
+
+// One bank per (channel, rank, bank), and the time each channel bus is free
+static bank_t *banks;
+static unsigned long long *bus_free;
+
+// Bytes moved by each request, the block size of the last-level cache
+static unsigned int line_size;
+
+// DRAM statistics
+static unsigned long long reads, writes;
+static unsigned long long row_hits, row_empty, row_conflicts;
+static unsigned long long busy_stalls, busy_cycles, total_latency;
+static unsigned long long first_issue, last_done;
+
+static void flat_init(unsigned int block_size)
+{
+  flat_reads = 0;
+  flat_writes = 0;
+}
+
+static unsigned long long flat_access(unsigned int address, int write, unsigned long long now)
+{
+  if(write){
+    flat_writes++;
+  }
+  else{
+    flat_reads++;
+  }
+  return flat_latency;
+}
+
+static void flat_finish(void)
+{
+  fprintf(stdout, "Main memory: %llu reads, %llu writes\n", flat_reads, flat_writes);
+}
+
+const backend_t flat_backend = { "flat", flat_init, flat_access, flat_finish };
+
+static void dram_init(unsigned int block_size)
+{
+  banks = calloc(dram_channels * dram_ranks * dram_banks, sizeof(bank_t));
+  bus_free = calloc(dram_channels, sizeof(unsigned long long));
+  if(banks == NULL || bus_free == NULL){
+    fprintf(stderr, "dram: out of memory\n");
+    exit(1);
+  }
+  line_size = block_size;
+  reads = 0;
+  writes = 0;
+  row_hits = 0;
+  row_empty = 0;
+  row_conflicts = 0;
+  busy_stalls = 0;
+  busy_cycles = 0;
+  total_latency = 0;
+  first_issue = 0;
+  last_done = 0;
+}
+
+/*
+ * Split an address into channel, rank, bank, row and column
+ * according to the configured address mapping
+ */
+static void dram_map(unsigned int address, unsigned int *channel, unsigned int *rank,
+                     unsigned int *bank, unsigned int *row)
+{
+  unsigned int line = address / line_size;
+  unsigned int columns = dram_row_size / line_size;
+
+  if(dram_mapping == 1){
+    *channel = line % dram_channels;
+    line /= dram_channels;
+    *bank = line % dram_banks;
+    line /= dram_banks;
+    *rank = line % dram_ranks;
+    line /= dram_ranks;
+    line /= columns;
+    *row = line;
+  }
+  else{
+    line /= columns;
+    *channel = line % dram_channels;
+    line /= dram_channels;
+    *bank = line % dram_banks;
+    line /= dram_banks;
+    *rank = line % dram_ranks;
+    line /= dram_ranks;
+    *row = line;
+    if(dram_mapping == 2){
+      *bank = (*bank ^ *row) % dram_banks;
+    }
+  }
+}
+
+static unsigned long long dram_access(unsigned int address, int write, unsigned long long now)
+{
+  unsigned int channel, rank, bank, row, latency;
+  unsigned int bursts = (line_size + dram_burst_size - 1) / dram_burst_size;
+  unsigned long long start, data, done;
+  bank_t *b;
+
+  dram_map(address, &channel, &rank, &bank, &row);
+  b = &banks[(channel * dram_ranks + rank) * dram_banks + bank];
+
+  if(reads + writes == 0){
+    first_issue = now;
+  }
+  if(write){
+    writes++;
+  }
+  else{
+    reads++;
+  }
+
+  // Wait for the bank to finish its previous request
+  start = now;
+  if(b->ready > now){
+    busy_stalls++;
+    busy_cycles += b->ready - now;
+    start = b->ready;
+  }
+
+  // Row hit, row empty (activate) or row conflict (precharge + activate)
+  if(b->open && b->row == row){
+    row_hits++;
+    latency = dram_tCAS;
+  }
+  else if(!b->open){
+    row_empty++;
+    latency = dram_tRCD + dram_tCAS;
+  }
+  else{
+    row_conflicts++;
+    latency = dram_tRP + dram_tRCD + dram_tCAS;
+  }
+
+  // Transfer the line once the channel bus is free
+  data = start + latency;
+  if(bus_free[channel] > data){
+    data = bus_free[channel];
+  }
+  done = data + bursts * dram_tBURST;
+  bus_free[channel] = done;
+
+  // Open-page keeps the row open, closed-page precharges after the access
+  if(dram_page_policy == 1){
+    b->open = 1;
+    b->row = row;
+    b->ready = done;
+  }
+  else{
+    b->open = 0;
+    b->ready = done + dram_tRP;
+  }
+
+  if(done > last_done){
+    last_done = done;
+  }
+  total_latency += done - now;
+  return done - now;
+}
+
+static void dram_finish(void)
+{
+  unsigned long long total = reads + writes;
+  unsigned long long cycles = last_done - first_issue;
+  double hitrate = total ? ((double)row_hits / (double)total) * 100 : 0;
+  double latency = total ? (double)total_latency / (double)total : 0;
+  // bytes / (cycles / MHz) = bytes per microsecond = MB/s; divide by 1000 for GB/s
+  double bandwidth = cycles ? ((double)total * line_size * dram_cpu_mhz) / ((double)cycles * 1000) : 0;
+  double peak = ((double)dram_channels * dram_burst_size * dram_cpu_mhz) / ((double)dram_tBURST * 1000);
+
+  fprintf(stdout, "DRAM (%s-page, %d channels, %d ranks, %d banks, %u B lines): %llu reads, %llu writes\n",
+          dram_page_policy ? "open" : "closed", dram_channels, dram_ranks, dram_banks, line_size, reads, writes);
+  fprintf(stdout, "Row buffer hitrate: %llu of %llu accesses; %f%c \n", row_hits, total, hitrate, '%');
+  fprintf(stdout, "Row buffer empty: %llu, bank conflicts: %llu\n", row_empty, row_conflicts);
+  fprintf(stdout, "Busy-bank stalls: %llu (%llu cycles), average latency: %f cycles\n", busy_stalls, busy_cycles, latency);
+  fprintf(stdout, "Achieved bandwidth: %f GB/s of %f GB/s peak over %llu cycles\n", bandwidth, peak, cycles);
+
+  free(banks);
+  free(bus_free);
+}
+
+const backend_t dram_backend = { "dram", dram_init, dram_access, dram_finish };
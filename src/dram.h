@@ -0,0 +1,29 @@
+/** @file dram.h
+ *  @brief Public API of main memory backends.
+ *  @see dram.c
+ */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+/* A backend receives the misses and writebacks of the last-level cache.
+ * init() gets the block size of that cache in bytes; every request
+ * transfers one block. access() returns the latency of the request in
+ * CPU cycles, counted from the cycle the request was issued (now).
+ */
+typedef struct backend {
+  const char *name;
+  void (*init)(unsigned int block_size);
+  unsigned long long (*access)(unsigned int address, int write, unsigned long long now);
+  void (*finish)(void);
+} backend_t;
+
+/** Fixed-latency main memory, with no banks or bandwidth limit.
+ */
+extern const backend_t flat_backend;
+
+/** DRAM with channels, ranks, banks and row buffers.
+ */
+extern const backend_t dram_backend;
+
+#endif
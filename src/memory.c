@@ -1,8 +1,12 @@
 
 #include "memory.h"
+#include "tlb.h"
+#include "dram.h"
+#include "mshr.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 // Cache parameters
@@ -21,8 +25,44 @@
 #define l2_assosiativity 8
 #define l2_policy 1
 
+// Virtual memory; set to 1 to translate addresses through the TLBs in tlb.c
+#define vm_enabled 0
+
+// Main memory below the level two cache; 0 = flat, 1 = DRAM (see dram.c)
+#define memory_backend 1
+// CPU cycles between two accesses in the trace, used when
+// the trace has no time stamps
+#define issue_interval 4
+
+// Non-blocking caches; MSHRs (outstanding misses) for each cache
+#define l1_instr_mshrs 8
+#define l1_data_mshrs 10
+#define l2_mshrs 32
+// Store misses waiting for the rest of their block (write-allocate);
+// the CPU stalls when the write buffer is full
+#define write_buffer_entries 8
+// Level two hit latency in CPU cycles
+#define l2_latency 14
+
+// Phase detection, checked at every report. A new phase starts when more
+// than phase_ws_threshold (0-1) of the working-set signature of an interval
+// is new to the phase while staying that close to the previous interval, or
+// when the misses per access of a cache stay more than phase_miss_threshold
+// from its phase average for two intervals
+#define phase_ws_threshold 0.5
+#define phase_miss_threshold 0.02
+// Size of the working-set signature, log2 of bits
+#define phase_signature_bits 16
+
 // Instruction counter
-static unsigned long instr_count;
+static unsigned long long instr_count;
+
+// Print every access when set
+static int verbose = 1;
+
+// Current cycle, cycles the CPU stalled on full MSHRs or write buffer,
+// cycles waiting for page walks, and time stamp of the next access given by the trace
+static unsigned long long now, stall_cycles, walk_cycles, trace_time;
 
 // Typedef-ing structures
 typedef struct cache cache_t;
@@ -31,6 +71,27 @@ typedef struct info info_t;
 // Global variables representing each cache structure
 static cache_t *cache_one_instr, *cache_one_data, *cache_two;
 
+// Main memory receiving misses and writebacks from the level two cache
+static const backend_t *backend;
+
+// Write buffer holding store misses of the level one data cache
+static mshr_t *write_buffer;
+
+// Time series output, one row per report
+static FILE *series;
+
+// Current phase, intervals and average misses per access of each cache in the phase,
+// and working-set signatures (hashed blocks touched) of this and the last interval
+// and of the intervals that make up the phase
+static int phase;
+static unsigned long phase_intervals;
+static double phase_miss[3];
+// Largest miss shift of the last interval
+static double last_shift;
+static unsigned char signature[(1 << phase_signature_bits) / 8];
+static unsigned char last_signature[(1 << phase_signature_bits) / 8];
+static unsigned char phase_signature[(1 << phase_signature_bits) / 8];
+
 // Structure for each cache block
 struct info {
   unsigned int index;
@@ -52,7 +113,11 @@ struct cache{
   int associativity;
   unsigned int hit;
   unsigned int miss;
+  // Hits and misses at the previous report
+  unsigned int hit_mark;
+  unsigned int miss_mark;
   int policy;
+  mshr_t *mshr;
   cache_t *next;
 };
 
@@ -76,6 +141,8 @@ static cache_t *cache_create(unsigned int size, unsigned int block_size, int ass
 
   cache->hit = 0;
   cache->miss = 0;
+  cache->hit_mark = 0;
+  cache->miss_mark = 0;
   cache->size = new_size;
   cache->blocksize = block_size;
   cache->associativity = associative;
@@ -129,21 +196,46 @@ void memory_init(void)
 {
   // Allocate memory for the three caches,
   // and set up the index values, and make each cache point
-  // to lower memory
+  // to lower memory. The level two cache is created first
+  // so the level one caches have something to point to
+  cache_two = cache_create(l2_size, l2_blocksize, l2_assosiativity, l2_policy);
+  set_index_lru(cache_two);
+  cache_two->next = NULL;
+  cache_two->mshr = mshr_create(l2_mshrs);
+
   cache_one_instr = cache_create(l1_instr_size, l1_instr_blocksize, l1_instr_assosiativity, l1_instr_policy);
   set_index_lru(cache_one_instr);
   cache_one_instr->next = cache_two;
+  cache_one_instr->mshr = mshr_create(l1_instr_mshrs);
 
   cache_one_data = cache_create(l1_data_size, l1_data_blocksize, l1_data_assosiativity, l1_data_policy);
   set_index_lru(cache_one_data);
   cache_one_data->next = cache_two;
+  cache_one_data->mshr = mshr_create(l1_data_mshrs);
+  write_buffer = mshr_create(write_buffer_entries);
 
-  cache_two = cache_create(l2_size, l2_blocksize, l2_assosiativity, l2_policy);
-  set_index_lru(cache_two);
-  cache_two->next = NULL;
+  // Set up main memory below the level two cache
+  backend = (memory_backend == 1) ? &dram_backend : &flat_backend;
+  backend->init(1u << cache_two->offset_bitsize);
 
-  // Set instruction_counter to 0
+  // Set up the TLBs and page table if addresses are translated
+  if(vm_enabled){
+    tlb_init();
+  }
+
+  // Set instruction_counter and clock to 0
   instr_count = 0;
+  now = 0;
+  stall_cycles = 0;
+  walk_cycles = 0;
+  trace_time = 0;
+
+  phase = 0;
+  phase_intervals = 0;
+  last_shift = 0;
+  memset(signature, 0, sizeof(signature));
+  memset(last_signature, 0, sizeof(last_signature));
+  memset(phase_signature, 0, sizeof(phase_signature));
 }
 
 /*
@@ -172,8 +264,8 @@ static int cache_contains(cache_t *cache, unsigned int address)
     // Check if the given index matches
     // the current array index
     if(cache->array[i]->index == addr_index){
-      // Check if the tag matches
-      if(cache->array[i]->tag == addr_tag){
+      // Check if the tag matches a valid block
+      if(cache->array[i]->tag == addr_tag && cache->array[i]->valid == 1){
         // Reset counter to the beginning of the current index
         i = i - (i % cache->associativity);
         int start_index = i;
@@ -202,6 +294,52 @@ static int cache_contains(cache_t *cache, unsigned int address)
   return 0;
 }
 
+/*
+ * Find the valid block holding the given address,
+ * and return its array-position, or -1 if it is not in the cache.
+ * Unlike cache_contains the lru values are left alone
+ */
+static int cache_find(cache_t *cache, unsigned int address)
+{
+  // Slice out the index and tag from the address
+  unsigned int addr_index = (address >> cache->offset_bitsize) & ((1 << cache->index_bitsize) - 1);
+  unsigned int addr_tag = address >> (cache->offset_bitsize + cache->index_bitsize);
+  int start_index = addr_index * cache->associativity;
+
+  for(int j = start_index; j < start_index + cache->associativity; j++){
+    if(cache->array[j]->valid == 1 && cache->array[j]->tag == addr_tag){
+      return j;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Find the least recently used block in the set
+ * starting at start_index, and return its array-position
+ */
+static int cache_victim(cache_t *cache, int start_index)
+{
+  int j;
+  for(j = start_index; j < start_index + cache->associativity - 1; j++){
+    if(cache->array[j]->lru == cache->associativity - 1){
+      break;
+    }
+  }
+  return j;
+}
+
+/*
+ * Update the lru-values for the set starting at start_index
+ */
+static void cache_update_lru(cache_t *cache, int start_index)
+{
+  int j;
+  for(j = start_index; j < start_index + cache->associativity; j++){
+    cache->array[j]->lru = (cache->array[j]->lru + 1) % cache->associativity;
+  }
+}
+
 /*
  * Function for read-operation for write-through policy
  */
@@ -228,32 +366,28 @@ static void cache_wt_read(cache_t *cache, unsigned int address)
     if(cache->array[i]->index == addr_index){
       // Store the start of the current index in the array
       start_index = i - (i % cache->associativity);
-      int j;
 
       // Find the highest lru value
-      for(j = 0; j < cache->associativity; j++){
-        if(cache->array[i]->lru == cache->associativity - 1){
-          break;
-        }
-      }
+      i = cache_victim(cache, start_index);
+
       // Give values for valid bit, dirtybit, and tag
       cache->array[i]->valid = 1;
       cache->array[i]->dirtybit = 0;
       cache->array[i]->tag = addr_tag;
 
       // Update all the lru-values on the current index
-      for(start_index; start_index < cache->associativity; start_index++){
-        cache->array[start_index]->lru = (cache->array[start_index]->lru + 1) % cache->associativity;
-      }
+      cache_update_lru(cache, start_index);
+      return;
     }
     i++;
   }
 }
 
 /*
- * Function for write-operation for write through
+ * Function for write-operation for write through,
+ * writing to main memory at the given cycle
  */
-static void cache_wt_write(cache_t *cache, unsigned int address)
+static void cache_wt_write(cache_t *cache, unsigned int address, unsigned long long cycle)
 {
   int i = 0;
   int start_index;
@@ -275,13 +409,8 @@ static void cache_wt_write(cache_t *cache, unsigned int address)
     // wanted index from the address
     if(cache->array[i]->index == addr_index){
       start_index = i - (i % cache->associativity);
-      int j;
       // Find the position of the highest lru-value
-      for(j = 0; j < cache->associativity; j++){
-        if(cache->array[i]->lru == cache->associativity - 1){
-          break;
-        }
-      }
+      i = cache_victim(cache, start_index);
       // Set new values for the tag, validbit and dirtybit,
       // on the least recently used block of the index
       cache->array[i]->tag = addr_tag;
@@ -295,13 +424,16 @@ static void cache_wt_write(cache_t *cache, unsigned int address)
         new_tag = cache->array[i]->tag << (cache->index_bitsize + cache->offset_bitsize);
         new_index = cache->array[i]->index << cache->offset_bitsize;
         new_address = new_tag + new_index;
-        cache_wt_write(cache->next, new_address);
+        cache_wt_write(cache->next, new_address, cycle);
+      }
+      // Below the last level the write goes to main memory
+      else{
+        backend->access(address, 1, cycle);
       }
 
       // Update the lru-values on the current index
-      for(start_index; start_index < cache->associativity; start_index++){
-        cache->array[start_index]->lru = (cache->array[start_index]->lru + 1) % cache->associativity;
-      }
+      cache_update_lru(cache, start_index);
+      return;
     }
   i++;
   }
@@ -309,9 +441,10 @@ static void cache_wt_write(cache_t *cache, unsigned int address)
 
 /*
  * Function for adding new address into cache when
- * a miss has occured, using write-back
+ * a miss has occured, using write-back.
+ * A dirty block evicted by the fill is written back at the given cycle
  */
-static void cache_add(cache_t *cache, unsigned int address)
+static void cache_add(cache_t *cache, unsigned int address, unsigned long long cycle)
 {
   int i = 0;
   int start_index;
@@ -327,21 +460,25 @@ static void cache_add(cache_t *cache, unsigned int address)
   addr_index = (address >> start) & bitmask;
   addr_tag = address >> (cache->offset_bitsize + cache->index_bitsize);
 
+  // A block written back from the level above may already be here;
+  // then it is only marked dirty instead of taking another way
+  if((i = cache_find(cache, address)) >= 0){
+    cache->array[i]->dirtybit = 1;
+    return;
+  }
+  i = 0;
+
   // Iterate through the array of the given cache
   while(i < cache->associativity * cache->index_sets){
     // Check if the current array-index matches
     // the wanted index from the address
     if(cache->array[i]->index == addr_index){
-      int start_index = i - (i % cache->associativity);
-      int j;
+      start_index = i - (i % cache->associativity);
 
       // Find the least recently used block and store
       // its array-position
-      for(j = 0; j < cache->associativity; j++){
-        if(cache->array[i]->lru == cache->associativity - 1){
-          break;
-        }
-      }
+      i = cache_victim(cache, start_index);
+
       // If the block is nt dirty we write values
       // straight into the block and mark it as
       // dirty.
@@ -352,23 +489,26 @@ static void cache_add(cache_t *cache, unsigned int address)
       }
       // If the block is dirty we check for lower memory cache
       else if(cache->array[i]->dirtybit == 1){
+        unsigned int new_tag, new_offset, new_index, new_address;
+        // Calculate the address based on the tag and index for the dirty block,
+        // and write it to the lower memory cache, or to main memory
+        // if this is the last level
+        new_tag = cache->array[i]->tag << (cache->index_bitsize + cache->offset_bitsize);
+        new_index = cache->array[i]->index << cache->offset_bitsize;
+        new_address = new_tag + new_index;
         if(cache->next != NULL){
-          unsigned int new_tag, new_offset, new_index, new_address;
-          // Calculate the address based on the tag and index for the dirty block,
-          // and write it to the lower memory cache
-          new_tag = cache->array[i]->tag << (cache->index_bitsize + cache->offset_bitsize);
-          new_index = cache->array[i]->index << cache->offset_bitsize;
-          new_address = new_tag + new_index;
-          cache_add(cache->next, new_address);
-          cache->array[i]->valid = 1;
-          cache->array[i]->dirtybit = 1;
-          cache->array[i]->tag = addr_tag;
+          cache_add(cache->next, new_address, cycle);
         }
+        else{
+          backend->access(new_address, 1, cycle);
+        }
+        cache->array[i]->valid = 1;
+        cache->array[i]->dirtybit = 1;
+        cache->array[i]->tag = addr_tag;
       }
       // Update the lru-values for the given index
-      for(start_index; start_index < cache->associativity; start_index++){
-        cache->array[start_index]->lru = (cache->array[start_index]->lru + 1) % cache->associativity;
-      }
+      cache_update_lru(cache, start_index);
+      return;
     }
     i++;
   }
@@ -413,14 +553,189 @@ static void set_dirtybit(cache_t *cache, unsigned int address, int dirtybit)
 }
 
 
+/*
+ * Read an address into the level two cache after a level one miss
+ * issued at the given cycle, and return the cycle the block is ready.
+ * A level two miss waits for a free MSHR and reads from main memory;
+ * the block it evicts is written back at the cycle the read is issued
+ */
+static unsigned long long cache_two_read(unsigned int address, unsigned long long issue)
+{
+  unsigned int block = address >> cache_two->offset_bitsize;
+  unsigned long long ready;
+  int merged;
+
+  issue += l2_latency;
+
+  // Check if address already is in cache
+  if(cache_contains(cache_two, address) == 1){
+    cache_two->hit++;
+    // The block can still be on its way from main memory
+    if(mshr_pending(cache_two->mshr, block, issue, &ready) == 1){
+      return ready;
+    }
+    return issue;
+  }
+  // Check if address is not in the cache
+  cache_two->miss++;
+  // Merge with a miss to the same block, or wait for a free MSHR
+  merged = mshr_lookup(cache_two->mshr, block, issue, &ready);
+  if(merged == 0){
+    issue = mshr_reserve(cache_two->mshr, issue);
+  }
+  // Check if write policy is write-back
+  if(cache_two->policy == 1){
+    // Read data into cache, and set dirtybit to 0
+    cache_add(cache_two, address, issue);
+    set_dirtybit(cache_two, address, 0);
+  }
+  // Check if write policy is write-through
+  else if(cache_two->policy == 0){
+    // Read data into cache
+    cache_wt_read(cache_two, address);
+  }
+
+  // Read the block from main memory
+  if(merged == 1){
+    return ready;
+  }
+  ready = issue + backend->access(address, 0, issue);
+  mshr_allocate(cache_two->mshr, block, issue, ready);
+  return ready;
+}
+
+/*
+ * Track a miss in a level one cache, in its MSHRs for reads or in the
+ * write buffer for stores, and return the cycle the block is ready.
+ * A miss to a block already being fetched is merged with it, otherwise
+ * the CPU stalls until an entry is free and the miss goes to level two
+ */
+static unsigned long long cache_one_miss(cache_t *cache, mshr_t *mshr, unsigned int address)
+{
+  unsigned int block = address >> cache->offset_bitsize;
+  unsigned long long issue, ready;
+
+  if(mshr_lookup(mshr, block, now, &ready) == 1){
+    return ready;
+  }
+  issue = mshr_reserve(mshr, now);
+  stall_cycles += issue - now;
+  now = issue;
+  ready = cache_two_read(address, issue);
+  mshr_allocate(mshr, block, issue, ready);
+  return ready;
+}
+
+/*
+ * Count a level one hit on a block that is still being fetched as a hit
+ * under miss, and return the cycle the block is ready. It stays a hit in
+ * the hitrates; only misses that miss in the tags count as secondary misses
+ */
+static unsigned long long cache_one_hit(cache_t *cache, unsigned int address)
+{
+  unsigned long long ready;
+  if(mshr_pending(cache->mshr, address >> cache->offset_bitsize, now, &ready) == 1){
+    return ready;
+  }
+  return now;
+}
+
+/*
+ * Record the block of an access in the working-set signature.
+ * Blocks are the same size as in the level one data cache. The block
+ * number goes through the murmur3 finalizer, so sequential and strided
+ * blocks land on independent bits as signature_blocks() assumes
+ */
+static void signature_add(unsigned int address)
+{
+  unsigned int bit = address >> cache_one_data->offset_bitsize;
+  bit ^= bit >> 16;
+  bit *= 0x85ebca6b;
+  bit ^= bit >> 13;
+  bit *= 0xc2b2ae35;
+  bit ^= bit >> 16;
+  bit >>= 32 - phase_signature_bits;
+  signature[bit / 8] |= 1 << (bit % 8);
+}
+
+/*
+ * Move the clock to the issue cycle of the next access; the time stamp
+ * from the trace if there is one, else issue_interval cycles later.
+ * Cycles stalled on full MSHRs or write buffer, or waiting for page walks,
+ * delay everything after them
+ */
+static void clock_tick(void)
+{
+  unsigned long long next = trace_time ? trace_time + stall_cycles + walk_cycles : now + issue_interval;
+  if(next > now){
+    now = next;
+  }
+  trace_time = 0;
+}
+
+/*
+ * Read a physical address through the data caches,
+ * and return the cycle the data is ready
+ */
+static unsigned long long data_read(unsigned int address)
+{
+  unsigned long long ready = now;
+
+  // Check if address already is in th cache
+  if(cache_contains(cache_one_data, address) == 1){
+    cache_one_data->hit++;
+    ready = cache_one_hit(cache_one_data, address);
+  }
+  // Check if the address is not in the cache
+  else if(cache_contains(cache_one_data, address) == 0){
+    cache_one_data->miss++;
+    // Check if the write policy is write-back
+    if(cache_one_data->policy == 1){
+      // Read data into cache, and set dirtybit to 0
+      cache_add(cache_one_data, address, now);
+      set_dirtybit(cache_one_data, address, 0);
+    }
+    // Check if write policy is write-through
+    else if(cache_one_data->policy == 0){
+      cache_wt_read(cache_one_data, address);
+    }
+    ready = cache_one_miss(cache_one_data, cache_one_data->mshr, address);
+  }
+  return ready;
+}
+
+/*
+ * Read a page-table entry during a page walk. The next level of the
+ * walk, and in the end the access itself, waits until the entry is read
+ */
+static void walk_read(unsigned int address)
+{
+  unsigned long long ready = data_read(address);
+  if(ready > now){
+    walk_cycles += ready - now;
+    now = ready;
+  }
+}
+
+
 /* Fetch addresses from trace file */
 void memory_fetch(unsigned int address, data_t *data)
 {
-  printf("memory: fetch 0x%08x\n", address);
+  if(verbose){
+    printf("memory: fetch 0x%08x\n", address);
+  }
+  clock_tick();
+
+  // Translate to a physical address; page walks go through the data caches
+  if(vm_enabled){
+    address = tlb_translate(address, 1, walk_read);
+  }
+  signature_add(address);
 
   // Check if address already is in the cache
   if(cache_contains(cache_one_instr, address) == 1){
     cache_one_instr->hit++;
+    cache_one_hit(cache_one_instr, address);
   }
   // Check if address doesn't exist in the cache
   else if(cache_contains(cache_one_instr, address) == 0){
@@ -428,7 +743,7 @@ void memory_fetch(unsigned int address, data_t *data)
     // Check if write policy for cache is write-back
     if(cache_one_instr->policy == 1){
       // Read address into cache, and set dirtybit to 0
-      cache_add(cache_one_instr, address);
+      cache_add(cache_one_instr, address, now);
       set_dirtybit(cache_one_instr, address, 0);
     }
     // Check if write policy is write-through
@@ -436,26 +751,7 @@ void memory_fetch(unsigned int address, data_t *data)
       // Read address into cache
       cache_wt_read(cache_one_instr, address);
     }
-
-    // Check if address already is in the cache
-    if(cache_contains(cache_two, address) == 1){
-      cache_two->hit++;
-    }
-    // Check if the address is not in the cache
-    else if(cache_contains(cache_two, address) == 0){
-      cache_two->miss++;
-      // Check if write policy is write-back
-      if(cache_two->policy == 1){
-        // Read address into cache, and set
-        // dirtybit to 0
-        cache_add(cache_two, address);
-        set_dirtybit(cache_one_instr, address, 0);
-      }
-      // Check if write policy is write-through
-      else if(cache_two->policy == 0){
-        cache_wt_read(cache_two, address);
-      }
-    }
+    cache_one_miss(cache_one_instr, cache_one_instr->mshr, address);
   }
   instr_count++;
 }
@@ -465,45 +761,18 @@ void memory_fetch(unsigned int address, data_t *data)
 /* Read addresses from trace file */
 void memory_read(unsigned int address, data_t *data)
 {
-  printf("memory: read 0x%08x\n", address);
-
-  // Check if address already is in th cache
-  if(cache_contains(cache_one_data, address) == 1){
-    cache_one_data->hit++;
+  if(verbose){
+    printf("memory: read 0x%08x\n", address);
   }
-  // Check if the address is not in the cache
-  else if(cache_contains(cache_one_data, address) == 0){
-    cache_one_data->miss++;
-    // Check if the write policy is write-back
-    if(cache_one_data->policy == 1){
-      // Read data into cache, and set dirtybit to 0
-      cache_add(cache_one_data, address);
-      set_dirtybit(cache_one_data, address, 0);
-    }
-    // Check if write policy is write-through
-    else if(cache_one_data->policy == 0){
-      cache_wt_read(cache_one_data, address);
-    }
-    // Check if address already is in cache
-    if(cache_contains(cache_two, address) == 1){
-      cache_two->hit++;
-    }
-    // Check if address is not in the cache
-    else if(cache_contains(cache_two, address) == 0){
-      cache_two->miss++;
-      // Check if write policy is write-back
-      if(cache_two->policy == 1){
-        // Read data into cache, and set dirtybit to 0
-        cache_add(cache_two, address);
-        set_dirtybit(cache_two, address, 0);
-      }
-      // Check if write policy is write-through
-      else if(cache_two->policy == 0){
-        // Read data into cache
-        cache_wt_read(cache_two, address);
-      }
-    }
+  clock_tick();
+
+  // Translate to a physical address; page walks go through the data caches
+  if(vm_enabled){
+    address = tlb_translate(address, 0, walk_read);
   }
+  signature_add(address);
+
+  data_read(address);
   instr_count++;
 }
 
@@ -511,16 +780,25 @@ void memory_read(unsigned int address, data_t *data)
 /* Write adress from trace file into cache */
 void memory_write(unsigned int address, data_t *data)
 {
-  printf("memory: write 0x%08x\n", address);
+  if(verbose){
+    printf("memory: write 0x%08x\n", address);
+  }
+  clock_tick();
+
+  // Translate to a physical address; page walks go through the data caches
+  if(vm_enabled){
+    address = tlb_translate(address, 0, walk_read);
+  }
+  signature_add(address);
 
   // Check if address already is in the cache
   if(cache_contains(cache_one_data, address) == 1){
     cache_one_data->hit++;
+    cache_one_hit(cache_one_data, address);
     // Check if write policy is write-back
     if(cache_one_data->policy == 1){
-      // Write data into cache, and set dirtybit to 1
-      cache_add(cache_one_data, address);
-      set_dirtybit(cache_one_data, address, 1);
+      // Mark the block holding the address as dirty
+      cache_one_data->array[cache_find(cache_one_data, address)]->dirtybit = 1;
     }
   }
   // Check if address is not already in the cache
@@ -529,19 +807,182 @@ void memory_write(unsigned int address, data_t *data)
     // Check if write policy is write-back
     if(cache_one_data->policy == 1){
       // Write data into cache, and set dirtybit to 1
-      cache_add(cache_one_data, address);
+      cache_add(cache_one_data, address, now);
       set_dirtybit(cache_one_data, address, 1);
+      // The store waits in the write buffer while the rest
+      // of the block is read from level two (write-allocate)
+      cache_one_miss(cache_one_data, write_buffer, address);
     }
     // Check if write policy is write-through
     else if(cache_one_data->policy == 0){
       // Write data into cache
-      cache_wt_write(cache_one_data, address);
+      cache_wt_write(cache_one_data, address, now);
     }
   }
   instr_count++;
 }
 
 
+/* Set the time stamp of the next access */
+void memory_time(unsigned long long time)
+{
+  trace_time = time;
+}
+
+/* Turn printing of every access on or off */
+void memory_verbose(int on)
+{
+  verbose = on;
+}
+
+// Print hitrate since the previous report and for the whole run for a cache,
+// and start a new interval
+static void cache_report(const char *name, cache_t *cache)
+{
+  unsigned int hit = cache->hit - cache->hit_mark;
+  unsigned int total = hit + cache->miss - cache->miss_mark;
+  double rolling = total ? ((double)hit / (double)total) * 100 : 0;
+  double overall = (cache->hit + cache->miss) ? ((double)cache->hit / (double)(cache->hit + cache->miss)) * 100 : 0;
+
+  fprintf(stdout, " %s %f%c (%f%c)", name, rolling, '%', overall, '%');
+  cache->hit_mark = cache->hit;
+  cache->miss_mark = cache->miss;
+}
+
+/*
+ * Estimate the number of distinct blocks in the working-set signature.
+ * Full is set when fewer than 1% of the bits are still clear; the
+ * estimate is then only a lower bound on the working set
+ */
+static double signature_blocks(int *full)
+{
+  double bits = 1 << phase_signature_bits;
+  int zeros = 0;
+  for(int i = 0; i < sizeof(signature); i++){
+    zeros += 8 - __builtin_popcount(signature[i]);
+  }
+  *full = zeros * 100 < bits;
+  // Every bit set; the working set is larger than the signature can tell
+  if(zeros == 0){
+    zeros = 1;
+  }
+  return -bits * log(zeros / bits);
+}
+
+/*
+ * Check if the interval that just ended starts a new phase,
+ * given the hits and misses of each cache in the interval.
+ * Misses are counted per level one access rather than per access
+ * to the cache, so a cache that is barely used cannot start a phase.
+ * A change must already have lasted two intervals, so one noisy interval
+ * does not start a phase. An interval that is far from the previous one
+ * (such as random accesses over a large area) never starts a phase on
+ * its working set alone
+ */
+static void phase_check(unsigned int *hit, unsigned int *miss)
+{
+  unsigned int differ = 0, touched = 0, novel = 0, blocks = 0;
+  unsigned int accesses = hit[0] + miss[0] + hit[1] + miss[1];
+  double distance = 1, novelty = 0, shift = 0, rate;
+  int i;
+
+  if(accesses == 0){
+    return;
+  }
+
+  // Relative distance between the signatures of this and the last interval,
+  // and the part of this interval that is new to the phase
+  for(i = 0; i < sizeof(signature); i++){
+    differ += __builtin_popcount(signature[i] ^ last_signature[i]);
+    touched += __builtin_popcount(signature[i] | last_signature[i]);
+    novel += __builtin_popcount(signature[i] & ~phase_signature[i]);
+    blocks += __builtin_popcount(signature[i]);
+  }
+  if(touched > 0){
+    distance = (double)differ / (double)touched;
+  }
+  if(blocks > 0){
+    novelty = (double)novel / (double)blocks;
+  }
+  // Largest change in misses per access from the phase average
+  for(i = 0; i < 3; i++){
+    if(phase_intervals > 0){
+      rate = (double)miss[i] / (double)accesses;
+      if(fabs(rate - phase_miss[i]) > shift){
+        shift = fabs(rate - phase_miss[i]);
+      }
+    }
+  }
+
+  if(phase == 0 || (distance <= phase_ws_threshold && novelty > phase_ws_threshold) ||
+     (shift > phase_miss_threshold && last_shift > phase_miss_threshold)){
+    phase++;
+    phase_intervals = 0;
+    memset(phase_signature, 0, sizeof(phase_signature));
+    if(phase > 1){
+      fprintf(stdout, "Phase %d starts after %llu instructions (working set %f new, misses per access shift %f)\n", phase, instr_count, novelty, shift);
+    }
+    shift = 0;
+  }
+  // Only intervals that fit the phase add to its working set,
+  // so passing noise does not grow it until everything matches
+  if(phase_intervals == 0 || novelty <= phase_ws_threshold){
+    for(i = 0; i < sizeof(signature); i++){
+      phase_signature[i] |= signature[i];
+    }
+  }
+  // Update the average misses per access of each cache over the phase
+  phase_intervals++;
+  for(i = 0; i < 3; i++){
+    rate = (double)miss[i] / (double)accesses;
+    phase_miss[i] += (rate - phase_miss[i]) / phase_intervals;
+  }
+  last_shift = shift;
+  memcpy(last_signature, signature, sizeof(signature));
+  memset(signature, 0, sizeof(signature));
+}
+
+/* Report hitrates since the previous report */
+void memory_report(int partial)
+{
+  cache_t *caches[3] = { cache_one_instr, cache_one_data, cache_two };
+  unsigned int hit[3], miss[3];
+  int full;
+  double blocks = signature_blocks(&full);
+
+  // Store the counters of the interval before cache_report starts a new one
+  for(int i = 0; i < 3; i++){
+    hit[i] = caches[i]->hit - caches[i]->hit_mark;
+    miss[i] = caches[i]->miss - caches[i]->miss_mark;
+  }
+
+  fprintf(stdout, "After %llu instructions:", instr_count);
+  cache_report("L1I", cache_one_instr);
+  cache_report("L1D", cache_one_data);
+  cache_report("L2", cache_two);
+  fprintf(stdout, "\n");
+
+  // A short last interval would always look like a new working set
+  if(!partial){
+    phase_check(hit, miss);
+  }
+  if(series != NULL){
+    fprintf(series, "%llu,%d,%u,%u,%u,%u,%u,%u,%.0f,%d\n", instr_count, phase,
+            hit[0], miss[0], hit[1], miss[1], hit[2], miss[2], blocks, full);
+    fflush(series);
+  }
+  // Push the line out straight away when the output is a pipe
+  fflush(stdout);
+}
+
+/* Write a time series row at every report */
+void memory_series(FILE *file)
+{
+  series = file;
+  fprintf(series, "instructions,phase,l1i_hits,l1i_misses,l1d_hits,l1d_misses,l2_hits,l2_misses,working_set_%uB_blocks,signature_full\n",
+          1u << cache_one_data->offset_bitsize);
+}
+
 // Deallocate memory for cache
 static void cache_destroy(cache_t *cache)
 {
@@ -550,16 +991,17 @@ static void cache_destroy(cache_t *cache)
   for(i = 0; i < cache->index_sets * cache->associativity; i++){
     free(cache->array[i]);
   }
-  // Free the memory allocated for the array,
+  // Free the memory allocated for the array, the MSHRs,
   // and the memory allocated for the cache itself
   free(cache->array);
+  mshr_destroy(cache->mshr);
   free(cache);
 }
 
 /* Deinitialize memory subsystem */
 void memory_finish(void)
 {
-  fprintf(stdout, "Executed %lu instructions.\n\n", instr_count);
+  fprintf(stdout, "Executed %llu instructions.\n\n", instr_count);
 
   unsigned int hitrate_one_instr, hitrate_one_data, hitrate_two, instr_miss, data_miss, l2_miss;
   double hit_ins, hit_data, hit_two;
@@ -581,9 +1023,33 @@ void memory_finish(void)
   fprintf(stdout, "Hitrate level one instruction cache: %u of %u instructions; %f%c \n", hitrate_one_instr, instr_miss, hit_ins, '%');
   fprintf(stdout, "Hitrate level one data cache: %u of %u instructions; %f%c \n", hitrate_one_data, data_miss, hit_data, '%');
   fprintf(stdout, "Hitrate level two cache: %u of %u instructions; %f%c \n", hitrate_two, l2_miss, hit_two, '%');
+  if(phase > 0){
+    fprintf(stdout, "Phases detected: %d\n", phase);
+  }
+
+  fprintf(stdout, "\n");
+  mshr_print("MSHRs level one instruction cache", cache_one_instr->mshr);
+  // Every level one data miss is counted once, in the MSHRs for
+  // reads and page walks or in the write buffer for stores
+  mshr_print("MSHRs level one data cache, reads", cache_one_data->mshr);
+  mshr_print("Write buffer level one data cache, stores", write_buffer);
+  mshr_print("MSHRs level two cache", cache_two->mshr);
+  fprintf(stdout, "Cycles to issue all accesses: %llu, stalled on full MSHRs and write buffer: %llu\n", now, stall_cycles);
+  if(vm_enabled){
+    fprintf(stdout, "Cycles waiting for page walks: %llu\n", walk_cycles);
+  }
+
+  fprintf(stdout, "\n");
+  backend->finish();
+
+  if(vm_enabled){
+    fprintf(stdout, "\n");
+    tlb_finish();
+  }
 
   // Deallocate memory that were allocated
   cache_destroy(cache_one_instr);
   cache_destroy(cache_one_data);
   cache_destroy(cache_two);
+  mshr_destroy(write_buffer);
 }
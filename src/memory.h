@@ -6,6 +6,8 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <stdio.h>
+
 /* data_t can be any 32-bit type, such as (unsigned long), (void *) or size_t
  * (on 32-bit x86).
  */
@@ -36,6 +38,35 @@ void memory_read(unsigned int address, data_t *data);
  */
 void memory_write(unsigned int address, data_t *data);
 
+/** Set the issue time of the next access, in CPU cycles. Without a time
+ *  stamp (or with 0) accesses are issued at a fixed rate.
+ *
+ *  @param[in] time Time stamp from the trace.
+ */
+void memory_time(unsigned long long time);
+
+/** Print hit rates for each cache since the previous report, and for the
+ *  whole run so far. Also writes a time series row (see memory_series())
+ *  and checks if a new phase has started.
+ *
+ *  @param[in] partial 1 if the interval was cut short by the end of the
+ *  trace; it is reported but not used for phase detection.
+ */
+void memory_report(int partial);
+
+/** Write the hits and misses of each cache, the working-set size and the
+ *  phase to a CSV file at every memory_report().
+ *
+ *  @param[in] file Open file to write the time series to.
+ */
+void memory_series(FILE *file);
+
+/** Turn printing of every access on or off (on by default).
+ *
+ *  @param[in] verbose 1 to print every access, 0 to stay quiet.
+ */
+void memory_verbose(int verbose);
+
 /** Clean up and deinitialize memory hierarchy.
  */
 void memory_finish (void);
@@ -0,0 +1,213 @@
+
+#include "mshr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Typedef-ing structures
+typedef struct mshr_entry mshr_entry_t;
+
+// Structure for each outstanding miss. A free entry keeps the
+// cycle it became free in ready
+struct mshr_entry {
+  unsigned int valid;
+  unsigned int block;
+  unsigned long long ready;
+};
+
+// Structure for each MSHR file
+struct mshr {
+  mshr_entry_t *array;
+  int entries;
+  int outstanding;
+  // Cycle up to which the statistics below are counted
+  unsigned long long last;
+  unsigned long long primary;
+  unsigned long long secondary;
+  unsigned long long hits_under_miss;
+  unsigned long long full_stalls;
+  // Sum of the waits of all requests that found every MSHR busy;
+  // waits that overlap are each counted
+  unsigned long long stall_cycles;
+  // Sum of the latencies of all primary misses
+  unsigned long long miss_cycles;
+  // Cycles with at least one miss outstanding
+  unsigned long long busy_cycles;
+  int peak;
+};
+
+/*
+ * Create an MSHR file with the given number of entries
+ */
+mshr_t *mshr_create(int entries)
+{
+  mshr_t *mshr = calloc(1, sizeof(mshr_t));
+  if(mshr == NULL){
+    return NULL;
+  }
+  mshr->array = calloc(entries, sizeof(mshr_entry_t));
+  if(mshr->array == NULL){
+    free(mshr);
+    return NULL;
+  }
+  mshr->entries = entries;
+  return mshr;
+}
+
+// Count the cycles from the last update up to the given cycle
+static void mshr_count(mshr_t *mshr, unsigned long long cycle)
+{
+  if(cycle > mshr->last){
+    if(mshr->outstanding > 0){
+      mshr->busy_cycles += cycle - mshr->last;
+    }
+    mshr->last = cycle;
+  }
+}
+
+// Find the outstanding miss that completes first, or -1 if there is none
+static int mshr_earliest(mshr_t *mshr)
+{
+  int first = -1;
+  for(int i = 0; i < mshr->entries; i++){
+    if(mshr->array[i].valid && (first < 0 || mshr->array[i].ready < mshr->array[first].ready)){
+      first = i;
+    }
+  }
+  return first;
+}
+
+// Find the entry that has been free the longest, or -1 if all are busy
+static int mshr_oldest_free(mshr_t *mshr)
+{
+  int first = -1;
+  for(int i = 0; i < mshr->entries; i++){
+    if(!mshr->array[i].valid && (first < 0 || mshr->array[i].ready < mshr->array[first].ready)){
+      first = i;
+    }
+  }
+  return first;
+}
+
+/*
+ * Move time forward to the given cycle,
+ * freeing every MSHR whose miss completes on the way
+ */
+static void mshr_advance(mshr_t *mshr, unsigned long long cycle)
+{
+  int first;
+  while((first = mshr_earliest(mshr)) >= 0 && mshr->array[first].ready <= cycle){
+    mshr_count(mshr, mshr->array[first].ready);
+    mshr->array[first].valid = 0;
+    mshr->outstanding--;
+  }
+  mshr_count(mshr, cycle);
+}
+
+// Find the outstanding miss to a block, or -1 if there is none
+static int mshr_find(mshr_t *mshr, unsigned int block, unsigned long long now)
+{
+  mshr_advance(mshr, now);
+  for(int i = 0; i < mshr->entries; i++){
+    if(mshr->array[i].valid && mshr->array[i].block == block){
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Merge with an outstanding miss to the same block */
+int mshr_lookup(mshr_t *mshr, unsigned int block, unsigned long long now, unsigned long long *ready)
+{
+  int i = mshr_find(mshr, block, now);
+  if(i < 0){
+    return 0;
+  }
+  mshr->secondary++;
+  *ready = mshr->array[i].ready;
+  return 1;
+}
+
+/* Check for a hit on a block that is still being filled */
+int mshr_pending(mshr_t *mshr, unsigned int block, unsigned long long now, unsigned long long *ready)
+{
+  int i = mshr_find(mshr, block, now);
+  if(i < 0){
+    return 0;
+  }
+  mshr->hits_under_miss++;
+  *ready = mshr->array[i].ready;
+  return 1;
+}
+
+/*
+ * Wait until an MSHR is free. Requests can arrive out of order, so a
+ * request from before the latest update only gets an entry that was
+ * already free at its cycle, or else waits for the cycle it became free
+ */
+unsigned long long mshr_reserve(mshr_t *mshr, unsigned long long now)
+{
+  unsigned long long free_at;
+
+  mshr_advance(mshr, now);
+  if(mshr->outstanding < mshr->entries){
+    free_at = mshr->array[mshr_oldest_free(mshr)].ready;
+    return free_at > now ? free_at : now;
+  }
+  // All MSHRs are busy; stall until the first one completes
+  free_at = mshr->array[mshr_earliest(mshr)].ready;
+  mshr->full_stalls++;
+  mshr->stall_cycles += free_at - now;
+  mshr_advance(mshr, free_at);
+  return free_at;
+}
+
+/* Record a primary miss in the entry mshr_reserve() waited for */
+void mshr_allocate(mshr_t *mshr, unsigned int block, unsigned long long issue, unsigned long long ready)
+{
+  int i = mshr_oldest_free(mshr);
+  if(i < 0){
+    return;
+  }
+  mshr_count(mshr, issue);
+  mshr->array[i].valid = 1;
+  mshr->array[i].block = block;
+  mshr->array[i].ready = ready;
+  mshr->outstanding++;
+  mshr->primary++;
+  mshr->miss_cycles += ready - issue;
+  if(mshr->outstanding > mshr->peak){
+    mshr->peak = mshr->outstanding;
+  }
+}
+
+/* Print MSHR statistics under the given name */
+void mshr_print(const char *name, mshr_t *mshr)
+{
+  int last = mshr_earliest(mshr);
+  double mlp;
+
+  // Let all outstanding misses complete
+  for(int i = 0; i < mshr->entries; i++){
+    if(mshr->array[i].valid && mshr->array[i].ready > mshr->array[last].ready){
+      last = i;
+    }
+  }
+  if(last >= 0){
+    mshr_advance(mshr, mshr->array[last].ready);
+  }
+  // Average number of misses outstanding while any miss is outstanding
+  mlp = mshr->busy_cycles ? (double)mshr->miss_cycles / (double)mshr->busy_cycles : 0;
+
+  fprintf(stdout, "%s (%d): %llu primary misses, %llu secondary misses merged, %llu hits under miss\n",
+          name, mshr->entries, mshr->primary, mshr->secondary, mshr->hits_under_miss);
+  fprintf(stdout, "  Full: %llu times (requests waited %llu cycles in total), MLP: %f (peak %d), miss cycles: %llu serialized, %llu overlapped\n",
+          mshr->full_stalls, mshr->stall_cycles, mlp, mshr->peak, mshr->miss_cycles, mshr->busy_cycles);
+}
+
+/* Deallocate an MSHR file */
+void mshr_destroy(mshr_t *mshr)
+{
+  free(mshr->array);
+  free(mshr);
+}
@@ -0,0 +1,68 @@
+/** @file mshr.h
+ *  @brief Public API of miss status holding registers (MSHRs).
+ *  @see mshr.c
+ */
+
+#ifndef MSHR_H
+#define MSHR_H
+
+typedef struct mshr mshr_t;
+
+/** Create an MSHR file.
+ *
+ *  @param[in] entries Number of misses that can be outstanding at once.
+ *  @return New MSHR file, or NULL if out of memory.
+ */
+mshr_t *mshr_create(int entries);
+
+/** Check if a miss to the given block is already outstanding. If it is,
+ *  the access is merged with it as a secondary miss.
+ *
+ *  @param[in] mshr MSHR file.
+ *  @param[in] block Block address.
+ *  @param[in] now Current cycle.
+ *  @param[out] ready Cycle the outstanding miss completes, if found.
+ *  @return 1 if the miss was merged, 0 if not.
+ */
+int mshr_lookup(mshr_t *mshr, unsigned int block, unsigned long long now, unsigned long long *ready);
+
+/** Check if a block that hit in the cache is still being filled by an
+ *  outstanding miss. Counted as a hit under miss, not as a miss.
+ *
+ *  @param[in] mshr MSHR file.
+ *  @param[in] block Block address.
+ *  @param[in] now Current cycle.
+ *  @param[out] ready Cycle the outstanding miss completes, if found.
+ *  @return 1 if the block is still being filled, 0 if not.
+ */
+int mshr_pending(mshr_t *mshr, unsigned int block, unsigned long long now, unsigned long long *ready);
+
+/** Wait for a free MSHR.
+ *
+ *  @param[in] mshr MSHR file.
+ *  @param[in] now Current cycle.
+ *  @return Cycle an MSHR is free; later than now if all were busy.
+ */
+unsigned long long mshr_reserve(mshr_t *mshr, unsigned long long now);
+
+/** Record a primary miss in a free MSHR (see mshr_reserve()).
+ *
+ *  @param[in] mshr MSHR file.
+ *  @param[in] block Block address.
+ *  @param[in] issue Cycle the miss is issued.
+ *  @param[in] ready Cycle the miss completes.
+ */
+void mshr_allocate(mshr_t *mshr, unsigned int block, unsigned long long issue, unsigned long long ready);
+
+/** Print MSHR and memory-level parallelism statistics.
+ *
+ *  @param[in] name Name to print, such as "MSHRs level two cache".
+ *  @param[in] mshr MSHR file.
+ */
+void mshr_print(const char *name, mshr_t *mshr);
+
+/** Deallocate an MSHR file.
+ */
+void mshr_destroy(mshr_t *mshr);
+
+#endif
@@ -0,0 +1,263 @@
+
+#include "tlb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Page parameters
+// Page size given as number of offset bits; 12 for 4K pages, 21 for 2M pages
+#define vm_page_bits 12
+// Page mapper; 0 = identity, 1 = random, 2 = first-touch
+#define vm_mapping 2
+#define vm_seed 2200
+// Physical address of the page table. Everything from here to the top
+// of memory is reserved for page tables and never handed out as a frame
+#define vm_table_base 0xff800000
+
+// TLB parameters (entries, associativity)
+#define l1_itlb_entries 64
+#define l1_itlb_assosiativity 4
+
+#define l1_dtlb_entries 64
+#define l1_dtlb_assosiativity 4
+
+#define l2_tlb_entries 1536
+#define l2_tlb_assosiativity 12
+
+// Size of a page-table entry in bytes
+#define PTE_SIZE 4
+
+// Typedef-ing structures
+typedef struct tlb tlb_t;
+typedef struct tlb_entry tlb_entry_t;
+
+// Global variables representing each TLB
+static tlb_t *tlb_one_instr, *tlb_one_data, *tlb_two;
+
+// Virtual page number -> physical frame number + 1 (0 means not mapped yet)
+static unsigned int *page_map;
+// Marks physical frames already handed out by the mapper
+static unsigned char *frame_used;
+static unsigned int frame_count, frame_next;
+
+// Page walk statistics
+static unsigned long walks, walk_accesses, pages_mapped;
+
+// Structure for each TLB entry
+struct tlb_entry {
+  unsigned int valid;
+  unsigned int vpn;
+  unsigned long lru;
+};
+
+// Structure for each TLB
+struct tlb {
+  tlb_entry_t *array;
+  unsigned int entries;
+  unsigned int sets;
+  int associativity;
+  unsigned long clock;
+  unsigned int hit;
+  unsigned int miss;
+};
+
+/*
+ * Create a TLB with given number of entries and associativity
+ */
+static tlb_t *tlb_create(unsigned int entries, int associative)
+{
+  tlb_t *tlb = malloc(sizeof(tlb_t));
+  if(tlb == NULL){
+    return NULL;
+  }
+  tlb->array = calloc(entries, sizeof(tlb_entry_t));
+  if(tlb->array == NULL){
+    free(tlb);
+    return NULL;
+  }
+  tlb->entries = entries;
+  tlb->associativity = associative;
+  tlb->sets = entries / associative;
+  tlb->clock = 0;
+  tlb->hit = 0;
+  tlb->miss = 0;
+  return tlb;
+}
+
+/*
+ * Look up a virtual page number in the TLB.
+ * Returns 1 on a hit and 0 on a miss, updating the lru value on a hit
+ */
+static int tlb_contains(tlb_t *tlb, unsigned int vpn)
+{
+  tlb_entry_t *set = &tlb->array[(vpn % tlb->sets) * tlb->associativity];
+
+  for(int i = 0; i < tlb->associativity; i++){
+    if(set[i].valid == 1 && set[i].vpn == vpn){
+      set[i].lru = ++tlb->clock;
+      tlb->hit++;
+      return 1;
+    }
+  }
+  tlb->miss++;
+  return 0;
+}
+
+/*
+ * Insert a virtual page number into the TLB,
+ * replacing an invalid or the least recently used entry in the set
+ */
+static void tlb_add(tlb_t *tlb, unsigned int vpn)
+{
+  tlb_entry_t *set = &tlb->array[(vpn % tlb->sets) * tlb->associativity];
+  int victim = 0;
+
+  for(int i = 0; i < tlb->associativity; i++){
+    if(set[i].valid == 0){
+      victim = i;
+      break;
+    }
+    if(set[i].lru < set[victim].lru){
+      victim = i;
+    }
+  }
+  set[victim].valid = 1;
+  set[victim].vpn = vpn;
+  set[victim].lru = ++tlb->clock;
+}
+
+/*
+ * Pick a physical frame for a virtual page touched for the first time
+ */
+static unsigned int frame_alloc(unsigned int vpn)
+{
+  unsigned int frame;
+
+  // Identity mapping; the page-table region may alias user pages
+  if(vm_mapping == 0){
+    return vpn;
+  }
+  // First-touch; hand out frames in the order pages are first used
+  if(vm_mapping == 2 && frame_next < frame_count){
+    frame = frame_next++;
+  }
+  // Random; probe from a random frame until a free one is found
+  else{
+    frame = (unsigned int)rand() % frame_count;
+  }
+  for(unsigned int i = 0; i < frame_count && frame_used[frame]; i++){
+    frame = (frame + 1) % frame_count;
+  }
+  // Out of physical memory; share the frame rather than fail
+  frame_used[frame] = 1;
+  return frame;
+}
+
+/*
+ * Walk the page table for a virtual address, reporting every
+ * page-table entry read to the given walk function.
+ * 4K pages use a two-level table (directory + table),
+ * 2M pages a single directory whose entries map pages directly
+ */
+static void page_walk(unsigned int address, walk_fn_t walk)
+{
+  unsigned int vpn = address >> vm_page_bits;
+  walks++;
+
+  if(vm_page_bits == 12){
+    unsigned int dir = address >> 22;
+    unsigned int table = (address >> 12) & 0x3ff;
+    if(walk != NULL){
+      walk(vm_table_base + dir * PTE_SIZE);
+      walk(vm_table_base + ((dir + 1) << 12) + table * PTE_SIZE);
+    }
+    walk_accesses += 2;
+  }
+  else{
+    if(walk != NULL){
+      walk(vm_table_base + vpn * PTE_SIZE);
+    }
+    walk_accesses++;
+  }
+}
+
+/* Initializing TLB hierarchy */
+void tlb_init(void)
+{
+  unsigned int pages = 1u << (32 - vm_page_bits);
+
+  tlb_one_instr = tlb_create(l1_itlb_entries, l1_itlb_assosiativity);
+  tlb_one_data = tlb_create(l1_dtlb_entries, l1_dtlb_assosiativity);
+  tlb_two = tlb_create(l2_tlb_entries, l2_tlb_assosiativity);
+
+  page_map = calloc(pages, sizeof(unsigned int));
+  frame_used = calloc(pages, sizeof(unsigned char));
+  if(tlb_one_instr == NULL || tlb_one_data == NULL || tlb_two == NULL
+     || page_map == NULL || frame_used == NULL){
+    fprintf(stderr, "tlb: out of memory\n");
+    exit(1);
+  }
+  // Frames below the page table are available to the mapper
+  frame_count = vm_table_base >> vm_page_bits;
+  frame_next = 0;
+
+  walks = 0;
+  walk_accesses = 0;
+  pages_mapped = 0;
+  srand(vm_seed);
+}
+
+/* Translate a virtual address through the TLB hierarchy */
+unsigned int tlb_translate(unsigned int address, int instr, walk_fn_t walk)
+{
+  tlb_t *tlb_one = instr ? tlb_one_instr : tlb_one_data;
+  unsigned int vpn = address >> vm_page_bits;
+  unsigned int offset = address & ((1u << vm_page_bits) - 1);
+
+  // Check level one TLB, then level two TLB, and walk the page table if both miss
+  if(tlb_contains(tlb_one, vpn) == 0){
+    if(tlb_contains(tlb_two, vpn) == 0){
+      page_walk(address, walk);
+      tlb_add(tlb_two, vpn);
+    }
+    tlb_add(tlb_one, vpn);
+  }
+  // Map the page on first touch
+  if(page_map[vpn] == 0){
+    page_map[vpn] = frame_alloc(vpn) + 1;
+    pages_mapped++;
+  }
+  return ((page_map[vpn] - 1) << vm_page_bits) | offset;
+}
+
+// Print hit statistics and reach for a TLB
+static void tlb_print(const char *name, tlb_t *tlb)
+{
+  unsigned int total = tlb->hit + tlb->miss;
+  double hitrate = total ? ((double)tlb->hit / (double)total) * 100 : 0;
+  unsigned long reach = (unsigned long)tlb->entries << (vm_page_bits - 10);
+
+  fprintf(stdout, "Hitrate %s: %u of %u translations; %f%c (reach %lu KB)\n", name, tlb->hit, total, hitrate, '%', reach);
+}
+
+// Deallocate memory for TLB
+static void tlb_destroy(tlb_t *tlb)
+{
+  free(tlb->array);
+  free(tlb);
+}
+
+/* Deinitialize TLB hierarchy */
+void tlb_finish(void)
+{
+  tlb_print("level one instruction TLB", tlb_one_instr);
+  tlb_print("level one data TLB", tlb_one_data);
+  tlb_print("level two TLB", tlb_two);
+  fprintf(stdout, "Page walks: %lu (%lu page-table accesses), %lu pages of %u KB mapped\n\n", walks, walk_accesses, pages_mapped, (1u << vm_page_bits) >> 10);
+
+  tlb_destroy(tlb_one_instr);
+  tlb_destroy(tlb_one_data);
+  tlb_destroy(tlb_two);
+  free(page_map);
+  free(frame_used);
+}
@@ -0,0 +1,32 @@
+/** @file tlb.h
+ *  @brief Public API of the virtual memory model (TLBs and page walks).
+ *  @see tlb.c
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+/* Called once for every page-table entry read during a page walk, with the
+ * physical address of the entry. Entries are read level by level, and each
+ * level needs the entry read by the level above.
+ */
+typedef void (*walk_fn_t)(unsigned int address);
+
+/** Initialize TLB hierarchy and page mapper.
+ */
+void tlb_init(void);
+
+/** Translate a virtual address to a physical address.
+ *
+ *  @param[in] address Virtual address.
+ *  @param[in] instr 1 if the access is an instruction fetch, 0 for data.
+ *  @param[in] walk Function called for each page-table access on a TLB miss.
+ *  @return Physical address.
+ */
+unsigned int tlb_translate(unsigned int address, int instr, walk_fn_t walk);
+
+/** Print TLB statistics and deinitialize the TLB hierarchy.
+ */
+void tlb_finish(void);
+
+#endif